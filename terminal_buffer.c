@@ -18,23 +18,49 @@
 #include <stdbool.h>
 #include <string.h>
 
+#include "terminal_buffer.h"
+
+struct terminal_buffer_sink
+{
+    bool attached;
+    bool flush;
+    uint8_t generation;     // Incremented each time the slot is attached.
+    uint32_t read_pos;      // The index this sink has consumed up to.
+    uint32_t max_lag;       // Maximum unread bytes before the sink is detached, 0 for no limit.
+    uint32_t (*write_cb)(void *buf, uint32_t bufsize);
+    void (*flush_cb)();
+};
+
 static struct terminal_buffer
 {
     void* output_buffer;    // The buffer to hold data to send to the client.
-    uint32_t output_start;  // The index the data begins at.
+    uint32_t output_start;  // The index the data begins at, the read position of the slowest sink.
     uint32_t output_end;    // The index of the position to add data.
     uint32_t output_length; // Total size of the output buffer.
 
-    bool flush;
+    struct terminal_buffer_sink sinks[TB_MAX_SINKS];
 } _terminal_buffer;
 
+static void _tb_reclaim();
+static void _tb_compact();
+static int8_t _tb_sink_slot(tb_sink_id sink);
+static uint32_t _tb_sink_write_size(uint8_t slot);
+static uint32_t _tb_sink_send(uint8_t slot, uint32_t (*write_cb)(void *buf, uint32_t bufsize), uint32_t size);
+static void _tb_sink_flush(uint8_t slot, void (*flush_cb)());
+
 void tb_init(void* write_buffer, uint32_t write_length)
 {
     _terminal_buffer.output_buffer = write_buffer;
     _terminal_buffer.output_start = 0;
     _terminal_buffer.output_end = 0;
     _terminal_buffer.output_length = write_length;
-    _terminal_buffer.flush = false;
+
+    // The primary sink is attached by the terminal handler once a client connects.
+    for (uint8_t i = 0; i < TB_MAX_SINKS; i++)
+    {
+        _terminal_buffer.sinks[i].attached = false;
+        _terminal_buffer.sinks[i].flush = false;
+    }
 }
 
 void tb_destroy()
@@ -43,60 +69,278 @@ void tb_destroy()
     _terminal_buffer.output_start = 0;
     _terminal_buffer.output_end = 0;
     _terminal_buffer.output_length = 0;
-    _terminal_buffer.flush = false;
+
+    // Generations are kept so ids from before the destroy remain stale.
+    for (uint8_t i = 0; i < TB_MAX_SINKS; i++)
+    {
+        _terminal_buffer.sinks[i].attached = false;
+        _terminal_buffer.sinks[i].flush = false;
+    }
+}
+
+tb_sink_id tb_attach_sink(uint32_t max_lag, uint32_t (*write_cb)(void *buf, uint32_t bufsize), void (*flush_cb)())
+{
+    for (uint8_t i = TB_PRIMARY_SINK + 1; i < TB_MAX_SINKS; i++)
+    {
+        struct terminal_buffer_sink *sink = &_terminal_buffer.sinks[i];
+        if (!sink->attached)
+        {
+            // A new sink only sees data written after it attached.
+            sink->attached = true;
+            sink->flush = false;
+            sink->read_pos = _terminal_buffer.output_end;
+            // A larger lag could never be reached so the sink would never be detached.
+            sink->max_lag = max_lag <= _terminal_buffer.output_length ? max_lag : _terminal_buffer.output_length;
+            sink->write_cb = write_cb;
+            sink->flush_cb = flush_cb;
+            // Generation 0 is never used, ids stay positive so -1 remains invalid.
+            sink->generation = sink->generation < 0x7F ? sink->generation + 1 : 1;
+            return (tb_sink_id)(sink->generation << 8 | i);
+        }
+    }
+
+    return -1;
+}
+
+void tb_detach_sink(tb_sink_id sink)
+{
+    int8_t slot = _tb_sink_slot(sink);
+    if (slot < 0)
+    {
+        return;
+    }
+
+    _terminal_buffer.sinks[slot].attached = false;
+    _terminal_buffer.sinks[slot].flush = false;
+    _tb_reclaim();
+}
+
+bool tb_sink_attached(tb_sink_id sink)
+{
+    return _tb_sink_slot(sink) >= 0;
 }
 
 uint32_t tb_write(void const* buffer, uint32_t buffsize)
 {
+    // Any sink that would fall too far behind is dropped before it can hold on to space.
+    for (uint8_t i = TB_PRIMARY_SINK + 1; i < TB_MAX_SINKS; i++)
+    {
+        struct terminal_buffer_sink *sink = &_terminal_buffer.sinks[i];
+        if (sink->attached && sink->max_lag &&
+            _terminal_buffer.output_end - sink->read_pos + buffsize > sink->max_lag)
+        {
+            sink->attached = false;
+            sink->flush = false;
+        }
+    }
+    _tb_reclaim();
+
     uint32_t available = _terminal_buffer.output_length - _terminal_buffer.output_end;
+    if (buffsize > available && _terminal_buffer.output_start > 0)
+    {
+        _tb_compact();
+        available = _terminal_buffer.output_length - _terminal_buffer.output_end;
+    }
+
     uint32_t towrite = buffsize <= available ? buffsize : available;
     memcpy(_terminal_buffer.output_buffer + _terminal_buffer.output_end, buffer, towrite);
     _terminal_buffer.output_end += towrite;
     return towrite;
 }
 
+uint32_t tb_write_available()
+{
+    _tb_reclaim();
+    return _terminal_buffer.output_length - (_terminal_buffer.output_end - _terminal_buffer.output_start);
+}
+
 void tb_flush()
 {
-    _terminal_buffer.flush = true;
+    for (uint8_t i = 0; i < TB_MAX_SINKS; i++)
+    {
+        if (_terminal_buffer.sinks[i].attached)
+        {
+            _terminal_buffer.sinks[i].flush = true;
+        }
+    }
+}
+
+uint32_t tb_sink_pending(tb_sink_id sink)
+{
+    int8_t slot = _tb_sink_slot(sink);
+    if (slot < 0)
+    {
+        return 0;
+    }
+
+    return _tb_sink_write_size(slot);
+}
+
+uint32_t tb_sink_drain(tb_sink_id sink, uint32_t size)
+{
+    int8_t slot = _tb_sink_slot(sink);
+    if (slot < 0)
+    {
+        return 0;
+    }
+
+    struct terminal_buffer_sink *current = &_terminal_buffer.sinks[slot];
+    uint32_t sent = _tb_sink_send(slot, current->write_cb, size);
+    if (!_tb_sink_write_size(slot) && current->flush_cb)
+    {
+        _tb_sink_flush(slot, current->flush_cb);
+    }
+
+    return sent;
 }
 
 /*
  * Internal Functions
  */
 
+/*
+ * Convert an id to the slot of an attached secondary sink, -1 if the id is stale or invalid.
+ */
+static int8_t _tb_sink_slot(tb_sink_id sink)
+{
+    if (sink < 0)
+    {
+        return -1;
+    }
+
+    uint8_t slot = sink & 0xFF;
+    uint8_t generation = sink >> 8;
+    if (slot <= TB_PRIMARY_SINK || slot >= TB_MAX_SINKS ||
+        !_terminal_buffer.sinks[slot].attached ||
+        _terminal_buffer.sinks[slot].generation != generation)
+    {
+        return -1;
+    }
+
+    return slot;
+}
+
+/*
+ * Move the start of the buffer up to the slowest attached sink, once every sink has
+ * consumed everything the buffer is reset to the beginning.
+ */
+static void _tb_reclaim()
+{
+    uint32_t start = _terminal_buffer.output_end;
+    for (uint8_t i = 0; i < TB_MAX_SINKS; i++)
+    {
+        struct terminal_buffer_sink *sink = &_terminal_buffer.sinks[i];
+        if (sink->attached && sink->read_pos < start)
+        {
+            start = sink->read_pos;
+        }
+    }
+
+    if (start == _terminal_buffer.output_end)
+    {
+        // Every sink has consumed everything.
+        for (uint8_t i = 0; i < TB_MAX_SINKS; i++)
+        {
+            _terminal_buffer.sinks[i].read_pos = 0;
+        }
+        _terminal_buffer.output_start = 0;
+        _terminal_buffer.output_end = 0;
+    }
+    else
+    {
+        _terminal_buffer.output_start = start;
+    }
+}
+
+/*
+ * Move the unconsumed data to the beginning of the buffer to make room for more.
+ */
+static void _tb_compact()
+{
+    uint32_t shift = _terminal_buffer.output_start;
+    memmove(_terminal_buffer.output_buffer,
+            _terminal_buffer.output_buffer + shift,
+            _terminal_buffer.output_end - shift);
+    _terminal_buffer.output_start = 0;
+    _terminal_buffer.output_end -= shift;
+
+    for (uint8_t i = 0; i < TB_MAX_SINKS; i++)
+    {
+        struct terminal_buffer_sink *sink = &_terminal_buffer.sinks[i];
+        if (sink->attached)
+        {
+            sink->read_pos -= shift;
+        }
+    }
+}
+
+void _tb_attach_primary()
+{
+    struct terminal_buffer_sink *sink = &_terminal_buffer.sinks[TB_PRIMARY_SINK];
+    sink->attached = true;
+    sink->flush = false;
+    sink->read_pos = _terminal_buffer.output_end;
+    // The primary sink is never detached for lagging.
+    sink->max_lag = 0;
+}
+
+void _tb_detach_primary()
+{
+    _terminal_buffer.sinks[TB_PRIMARY_SINK].attached = false;
+    _terminal_buffer.sinks[TB_PRIMARY_SINK].flush = false;
+    _tb_reclaim();
+}
+
 uint32_t _tb_write_size()
 {
-    return _terminal_buffer.output_end - _terminal_buffer.output_start;
+    return _tb_sink_write_size(TB_PRIMARY_SINK);
 }
 
 uint32_t _tb_send(uint32_t (*write_cb)(void *buf, uint32_t bufsize), uint32_t size)
 {
-    uint32_t available = _tb_write_size();
-    uint32_t tosend = available >= size ? size : available;
+    return _tb_sink_send(TB_PRIMARY_SINK, write_cb, size);
+}
 
-    uint32_t sent = write_cb(_terminal_buffer.output_buffer + _terminal_buffer.output_start,
-                             tosend);
+void _tb_flush(void (*flush_cb)())
+{
+    _tb_sink_flush(TB_PRIMARY_SINK, flush_cb);
+}
 
-    if (sent < available)
+static uint32_t _tb_sink_write_size(uint8_t slot)
+{
+    if (!_terminal_buffer.sinks[slot].attached)
     {
-        // Just move the start offset along for now.
-        _terminal_buffer.output_start += sent;
+        return 0;
     }
-    else
+
+    return _terminal_buffer.output_end - _terminal_buffer.sinks[slot].read_pos;
+}
+
+static uint32_t _tb_sink_send(uint8_t slot, uint32_t (*write_cb)(void *buf, uint32_t bufsize), uint32_t size)
+{
+    uint32_t available = _tb_sink_write_size(slot);
+    if (!available)
     {
-        // We sent it all.
-        _terminal_buffer.output_start = 0;
-        _terminal_buffer.output_end = 0;
+        return 0;
     }
 
+    uint32_t tosend = available >= size ? size : available;
+
+    struct terminal_buffer_sink *current = &_terminal_buffer.sinks[slot];
+    uint32_t sent = write_cb(_terminal_buffer.output_buffer + current->read_pos, tosend);
+
+    // Space is only reclaimed once the slowest sink has moved past it.
+    current->read_pos += sent;
+    _tb_reclaim();
+
     return sent;
 }
 
-void _tb_flush(void (*flush_cb)())
+static void _tb_sink_flush(uint8_t slot, void (*flush_cb)())
 {
-    if (_terminal_buffer.flush)
+    if (_terminal_buffer.sinks[slot].attached && _terminal_buffer.sinks[slot].flush)
     {
-        _terminal_buffer.flush = false;
+        _terminal_buffer.sinks[slot].flush = false;
         flush_cb();
     }
 }
@@ -15,6 +15,32 @@
  */
 
 #include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * The output written to the buffer can be consumed by multiple sinks, each reading at
+ * its own rate. Space is only reclaimed once every attached sink has consumed it.
+ *
+ * tb_init is called once with the buffer used for all output, the terminal handler does
+ * this in terminal_handler_init.
+ *
+ * Sink 0 is the primary sink, the USB CDC connection. The terminal handler attaches it
+ * each time a client connects and detaches it on disconnect, while detached it holds no
+ * space in the buffer.
+ *
+ * Secondary sinks, e.g. a UART mirror, are attached by the application and remain
+ * attached across connections of the primary sink until they are detached or fall too
+ * far behind. The application drains each one from its main loop using tb_sink_drain.
+ */
+#define TB_MAX_SINKS 4
+#define TB_PRIMARY_SINK 0
+
+/*
+ * Handle to a secondary sink, it combines the slot with a generation count for the slot
+ * so that a handle to a sink which has been detached never matches a later sink which
+ * reuses the same slot.
+ */
+typedef int16_t tb_sink_id;
 
 /*
  * Initialisation Functions
@@ -25,24 +51,77 @@ void tb_init(void* output_buffer, uint32_t output_length);
 
 void tb_destroy();
 
+/*
+ * Attach an additional sink which will receive all data written from this point on.
+ *
+ * The write_cb is called by tb_sink_drain with the data to send and returns how much it
+ * accepted, the flush_cb is called once all data has been sent following a tb_flush.
+ *
+ * If the sink falls more than max_lag bytes behind the writer it is detached so that
+ * it can not hold space in the buffer, a max_lag of 0 means the sink is never detached.
+ * A max_lag larger than the buffer passed to tb_init is reduced to the buffer length.
+ *
+ * Returns the id of the sink or -1 if no more sinks can be attached.
+ */
+tb_sink_id tb_attach_sink(uint32_t max_lag, uint32_t (*write_cb)(void *buf, uint32_t bufsize), void (*flush_cb)());
+
+void tb_detach_sink(tb_sink_id sink);
+
+/*
+ * Check if a sink is still attached, i.e. it has not been detached for lagging.
+ *
+ * Once this returns false the id is stale and should be discarded, attach again to
+ * resume receiving output.
+ */
+bool tb_sink_attached(tb_sink_id sink);
+
 /*
  * Functions for the writing of output data and reading of input data.
  */
 
 uint32_t tb_write(void const* buffer, uint32_t buffsize);
 
+/*
+ * Space currently available for tb_write.
+ */
+uint32_t tb_write_available();
+
 void tb_flush();
 
+/*
+ * Current size of data waiting to be sent to a secondary sink.
+ */
+uint32_t tb_sink_pending(tb_sink_id sink);
+
+/*
+ * Send up to size bytes of the pending data to a secondary sink using its write_cb, if
+ * everything has been sent and a flush was requested the flush_cb is then called.
+ *
+ * Returns the number of bytes sent.
+ */
+uint32_t tb_sink_drain(tb_sink_id sink, uint32_t size);
+
 /*
  * Internal functions for providing the internal ability to read the data in the output buffer
  * and to write the data to the input buffer.
  */
 
 /*
- * Current size of data to write.
+ * Attach the primary sink when a client connects, it only sees data written from this
+ * point on.
+ */
+void _tb_attach_primary();
+
+/*
+ * Detach the primary sink when the client disconnects so it no longer holds space.
+ */
+void _tb_detach_primary();
+
+/*
+ * Current size of data to write to the primary sink.
  */
 uint32_t _tb_write_size();
 
 uint32_t _tb_send(uint32_t (*write_cb)(void *buf, uint32_t bufsize), uint32_t size);
 
-void _tb_flush(void (*flush_cb)());
\ No newline at end of file
+void _tb_flush(void (*flush_cb)());
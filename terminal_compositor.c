@@ -0,0 +1,534 @@
+/* Copyright 2024, Darran A Lofthouse
+ *
+ * This file is part of pico-term.
+ *
+ * pico-term is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * pico-term is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with pico-term.
+ * If  not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "terminal_compositor.h"
+#include "vt102.h"
+
+/*
+ * If the cursor only needs to move this many columns to the right it is cheaper
+ * to write out the characters already on screen than to send a CUP.
+ */
+#define TC_MAX_REWRITE 4
+
+/*
+ * Runs of blank cells at least this long are cleared with ECH instead of writing spaces.
+ */
+#define TC_MIN_ERASE 5
+
+/*
+ * The most bytes needed for a single CUP, ECH and the initial clear of the display.
+ *
+ * Nothing is written unless there is room in the output buffer for the complete sequence,
+ * so a frame too large for the buffer is written over multiple calls to tc_render.
+ */
+#define TC_MAX_CUP 10
+#define TC_MAX_ECH 6
+#define TC_MAX_CLEAR 7
+
+static void _tc_pane_new_line(struct tc_pane *pane);
+static void _tc_build_owner(struct tc_compositor *compositor);
+static bool _tc_scroll(struct tc_compositor *compositor, uint8_t index);
+static bool _tc_update_rect(struct tc_compositor *compositor, uint8_t top, uint8_t left, uint8_t rows, uint8_t columns);
+static char _tc_desired(struct tc_compositor *compositor, uint16_t row, uint16_t column);
+static void _tc_move_cursor(struct tc_compositor *compositor, uint8_t row, uint8_t column);
+static void _tc_uint_to_str(uint16_t value, char *str);
+
+/*
+ * Pane Functions
+ */
+
+void tc_pane_init(struct tc_pane *pane, uint8_t top, uint8_t left, uint8_t rows, uint8_t columns,
+                  char *surface, bool scrolling)
+{
+    pane->top = top;
+    pane->left = left;
+    pane->rows = rows;
+    pane->columns = columns;
+    pane->z = 0;
+    pane->visible = true;
+    pane->scrolling = scrolling;
+    pane->surface = surface;
+    tc_pane_clear(pane);
+}
+
+void tc_pane_clear(struct tc_pane *pane)
+{
+    memset(pane->surface, ' ', pane->rows * pane->columns);
+    pane->cursor_row = 0;
+    pane->cursor_column = 0;
+    // The whole surface is redrawn anyway so there is nothing to gain from scrolling.
+    pane->pending_scroll = 0;
+    pane->dirty = true;
+}
+
+void tc_pane_move(struct tc_pane *pane, uint8_t row, uint8_t column)
+{
+    pane->cursor_row = row < pane->rows ? row : pane->rows - 1;
+    pane->cursor_column = column < pane->columns ? column : pane->columns - 1;
+}
+
+void tc_pane_write_char(struct tc_pane *pane, char ch)
+{
+    if (ch == '\r')
+    {
+        pane->cursor_column = 0;
+        return;
+    }
+    else if (ch == '\n')
+    {
+        _tc_pane_new_line(pane);
+        return;
+    }
+    else if (ch < 0x20 || ch > 0x7E)
+    {
+        // Anything else would move the terminal cursor or start an escape sequence.
+        return;
+    }
+
+    if (pane->cursor_column >= pane->columns)
+    {
+        // Deferred wrap so a full line followed by a new line does not leave a blank line.
+        _tc_pane_new_line(pane);
+    }
+
+    if (pane->cursor_row >= pane->rows)
+    {
+        // Non-scrolling pane, anything past the last row is clipped.
+        return;
+    }
+
+    pane->surface[pane->cursor_row * pane->columns + pane->cursor_column] = ch;
+    pane->cursor_column++;
+    pane->dirty = true;
+}
+
+void tc_pane_write_str(struct tc_pane *pane, char const *str)
+{
+    while (*str)
+    {
+        tc_pane_write_char(pane, *str++);
+    }
+}
+
+static void _tc_pane_new_line(struct tc_pane *pane)
+{
+    pane->cursor_column = 0;
+    if (pane->cursor_row + 1 < pane->rows)
+    {
+        pane->cursor_row++;
+    }
+    else if (pane->scrolling)
+    {
+        uint16_t line = pane->columns;
+        memmove(pane->surface, pane->surface + line, (pane->rows - 1) * line);
+        memset(pane->surface + (pane->rows - 1) * line, ' ', line);
+        if (pane->pending_scroll < pane->rows)
+        {
+            pane->pending_scroll++;
+        }
+        pane->dirty = true;
+    }
+    else
+    {
+        pane->cursor_row = pane->rows;
+    }
+}
+
+/*
+ * Compositor Functions
+ */
+
+void tc_init(struct tc_compositor *compositor, uint8_t rows, uint8_t columns, char *screen, uint8_t *owner)
+{
+    compositor->rows = rows;
+    compositor->columns = columns;
+    compositor->max_rows = rows;
+    compositor->max_columns = columns;
+    compositor->use_erase_characters = false;
+    compositor->screen = screen;
+    compositor->owner = owner;
+    compositor->pane_count = 0;
+    compositor->focus = 0;
+    tc_invalidate(compositor);
+}
+
+bool tc_add_pane(struct tc_compositor *compositor, struct tc_pane *pane)
+{
+    if (compositor->pane_count >= TC_MAX_PANES)
+    {
+        return false;
+    }
+
+    compositor->panes[compositor->pane_count++] = pane;
+    compositor->layout_dirty = true;
+    return true;
+}
+
+void tc_set_z(struct tc_compositor *compositor, struct tc_pane *pane, uint8_t z)
+{
+    pane->z = z;
+    compositor->layout_dirty = true;
+}
+
+void tc_set_visible(struct tc_compositor *compositor, struct tc_pane *pane, bool visible)
+{
+    pane->visible = visible;
+    compositor->layout_dirty = true;
+}
+
+void tc_move_pane(struct tc_compositor *compositor, struct tc_pane *pane, uint8_t top, uint8_t left)
+{
+    pane->top = top;
+    pane->left = left;
+    compositor->layout_dirty = true;
+}
+
+void tc_set_focus(struct tc_compositor *compositor, struct tc_pane *pane)
+{
+    compositor->focus = pane;
+}
+
+void tc_set_capabilities(struct tc_compositor *compositor, vt102_capabilities const *capabilities)
+{
+    compositor->rows = compositor->max_rows;
+    compositor->columns = compositor->max_columns;
+    if (capabilities->rows && capabilities->rows < compositor->rows)
+    {
+        compositor->rows = capabilities->rows;
+    }
+    if (capabilities->columns && capabilities->columns < compositor->columns)
+    {
+        compositor->columns = capabilities->columns;
+    }
+
+    compositor->use_erase_characters = capabilities->erase_characters;
+
+    // The size of the screen may have changed so redraw everything.
+    tc_invalidate(compositor);
+}
+
+void tc_invalidate(struct tc_compositor *compositor)
+{
+    compositor->screen_unknown = true;
+    compositor->layout_dirty = true;
+    compositor->cursor_known = false;
+}
+
+void tc_render(struct tc_compositor *compositor)
+{
+    bool complete = true;
+
+    if (compositor->screen_unknown)
+    {
+        if (_vt102_write_available() < TC_MAX_CLEAR)
+        {
+            return;
+        }
+
+        vt102_decstbm_reset();
+        vt102_erase_display();
+        memset(compositor->screen, ' ', compositor->rows * compositor->columns);
+        compositor->screen_unknown = false;
+        compositor->cursor_known = false;
+    }
+
+    if (compositor->layout_dirty)
+    {
+        // Anything could have been uncovered so compare the whole screen.
+        _tc_build_owner(compositor);
+        complete = _tc_update_rect(compositor, 0, 0, compositor->rows, compositor->columns);
+        if (complete)
+        {
+            for (uint8_t i = 0; i < compositor->pane_count; i++)
+            {
+                compositor->panes[i]->pending_scroll = 0;
+                compositor->panes[i]->dirty = false;
+            }
+            compositor->layout_dirty = false;
+        }
+    }
+    else
+    {
+        for (uint8_t i = 0; complete && i < compositor->pane_count; i++)
+        {
+            struct tc_pane *pane = compositor->panes[i];
+            if (!pane->dirty)
+            {
+                continue;
+            }
+
+            // Panes which are completely covered are never repainted.
+            if (compositor->visible_cells[i])
+            {
+                complete = (!pane->pending_scroll || _tc_scroll(compositor, i)) &&
+                           _tc_update_rect(compositor, pane->top, pane->left, pane->rows, pane->columns);
+            }
+
+            if (complete)
+            {
+                pane->pending_scroll = 0;
+                pane->dirty = false;
+            }
+        }
+    }
+
+    if (!complete)
+    {
+        // The buffer is full, the rest of the frame is written by the next call.
+        compositor->cursor_known = false;
+        _vt102_write_flush();
+        return;
+    }
+
+    struct tc_pane *focus = compositor->focus;
+    if (focus && focus->visible && _vt102_write_available() >= TC_MAX_CUP)
+    {
+        uint8_t row = focus->cursor_row < focus->rows ? focus->cursor_row : focus->rows - 1;
+        uint8_t column = focus->cursor_column < focus->columns ? focus->cursor_column : focus->columns - 1;
+        row += focus->top;
+        column += focus->left;
+        if (row < compositor->rows && column < compositor->columns)
+        {
+            _tc_move_cursor(compositor, row, column);
+        }
+    }
+
+    _vt102_write_flush();
+}
+
+/*
+ * Internal Functions
+ */
+
+static void _tc_build_owner(struct tc_compositor *compositor)
+{
+    uint16_t screen_size = compositor->rows * compositor->columns;
+    memset(compositor->owner, TC_NO_PANE, screen_size);
+    memset(compositor->visible_cells, 0, sizeof(compositor->visible_cells));
+
+    // Sort by z, panes added later are drawn over earlier panes with the same z.
+    uint8_t order[TC_MAX_PANES];
+    for (uint8_t i = 0; i < compositor->pane_count; i++)
+    {
+        uint8_t j = i;
+        while (j > 0 && compositor->panes[order[j - 1]]->z > compositor->panes[i]->z)
+        {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    for (uint8_t i = 0; i < compositor->pane_count; i++)
+    {
+        struct tc_pane *pane = compositor->panes[order[i]];
+        if (!pane->visible)
+        {
+            continue;
+        }
+
+        for (uint16_t row = pane->top; row < pane->top + pane->rows && row < compositor->rows; row++)
+        {
+            for (uint16_t column = pane->left; column < pane->left + pane->columns && column < compositor->columns; column++)
+            {
+                compositor->owner[row * compositor->columns + column] = order[i];
+            }
+        }
+    }
+
+    for (uint16_t i = 0; i < screen_size; i++)
+    {
+        if (compositor->owner[i] != TC_NO_PANE)
+        {
+            compositor->visible_cells[compositor->owner[i]]++;
+        }
+    }
+}
+
+/*
+ * Use a scroll region to move the lines already on the terminal rather than redrawing them,
+ * this is only possible for a pane which is fully visible and spans the full width.
+ *
+ * Returns false if there is not yet room in the output buffer.
+ */
+static bool _tc_scroll(struct tc_compositor *compositor, uint8_t index)
+{
+    struct tc_pane *pane = compositor->panes[index];
+    uint8_t lines = pane->pending_scroll;
+    if (pane->left != 0 || pane->columns != compositor->columns ||
+        pane->top + pane->rows > compositor->rows ||
+        compositor->visible_cells[index] != pane->rows * pane->columns ||
+        lines >= pane->rows)
+    {
+        // Redrawn instead.
+        return true;
+    }
+
+    // DECSTBM is no longer than a CUP, the reset is 3 bytes.
+    if (_vt102_write_available() < (uint32_t)(2 * TC_MAX_CUP + 2 * lines + 3))
+    {
+        return false;
+    }
+
+    char top[4];
+    char bottom[4];
+    _tc_uint_to_str(pane->top + 1, top);
+    _tc_uint_to_str(pane->top + pane->rows, bottom);
+
+    vt102_decstbm(top, bottom);
+    vt102_cup(bottom, "1");
+    for (uint8_t i = 0; i < lines; i++)
+    {
+        vt102_ind();
+    }
+    // Resetting the margins also homes the cursor.
+    vt102_decstbm_reset();
+    compositor->cursor_known = false;
+
+    uint16_t line = compositor->columns;
+    char *region = compositor->screen + pane->top * line;
+    memmove(region, region + lines * line, (pane->rows - lines) * line);
+    memset(region + (pane->rows - lines) * line, ' ', lines * line);
+    pane->pending_scroll = 0;
+
+    return true;
+}
+
+/*
+ * Returns false if the output buffer filled before every cell was written, the screen
+ * only records the cells which were written.
+ */
+static bool _tc_update_rect(struct tc_compositor *compositor, uint8_t top, uint8_t left, uint8_t rows, uint8_t columns)
+{
+    for (uint16_t row = top; row < top + rows && row < compositor->rows; row++)
+    {
+        for (uint16_t column = left; column < left + columns && column < compositor->columns; column++)
+        {
+            uint16_t cell = row * compositor->columns + column;
+            char desired = _tc_desired(compositor, row, column);
+
+            if (compositor->screen[cell] != desired)
+            {
+                if (desired == ' ' && compositor->use_erase_characters)
+                {
+                    uint16_t end = column + 1;
+                    while (end < left + columns && end < compositor->columns && _tc_desired(compositor, row, end) == ' ')
+                    {
+                        end++;
+                    }
+
+                    if (end - column >= TC_MIN_ERASE)
+                    {
+                        if (_vt102_write_available() < TC_MAX_CUP + TC_MAX_ECH)
+                        {
+                            return false;
+                        }
+
+                        // ECH does not move the cursor.
+                        char count[4];
+                        _tc_uint_to_str(end - column, count);
+                        _tc_move_cursor(compositor, row, column);
+                        vt102_ech(count);
+                        memset(compositor->screen + cell, ' ', end - column);
+                        column = end - 1;
+                        continue;
+                    }
+                }
+
+                if (_vt102_write_available() < TC_MAX_CUP + 1)
+                {
+                    return false;
+                }
+
+                _tc_move_cursor(compositor, row, column);
+                if (!_vt102_write_char(desired))
+                {
+                    compositor->cursor_known = false;
+                    return false;
+                }
+                compositor->screen[cell] = desired;
+                if (++compositor->cursor_column >= compositor->columns)
+                {
+                    // The terminal may or may not have wrapped.
+                    compositor->cursor_known = false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+static char _tc_desired(struct tc_compositor *compositor, uint16_t row, uint16_t column)
+{
+    uint8_t owner = compositor->owner[row * compositor->columns + column];
+    if (owner == TC_NO_PANE)
+    {
+        return ' ';
+    }
+
+    struct tc_pane *pane = compositor->panes[owner];
+    return pane->surface[(row - pane->top) * pane->columns + (column - pane->left)];
+}
+
+static void _tc_move_cursor(struct tc_compositor *compositor, uint8_t row, uint8_t column)
+{
+    if (compositor->cursor_known && compositor->cursor_row == row)
+    {
+        if (compositor->cursor_column == column)
+        {
+            return;
+        }
+        else if (column > compositor->cursor_column && column - compositor->cursor_column <= TC_MAX_REWRITE)
+        {
+            _vt102_write(compositor->screen + row * compositor->columns + compositor->cursor_column,
+                         column - compositor->cursor_column);
+            compositor->cursor_column = column;
+            return;
+        }
+    }
+
+    char line[4];
+    char col[4];
+    _tc_uint_to_str(row + 1, line);
+    _tc_uint_to_str(column + 1, col);
+    vt102_cup(line, col);
+
+    compositor->cursor_known = true;
+    compositor->cursor_row = row;
+    compositor->cursor_column = column;
+}
+
+static void _tc_uint_to_str(uint16_t value, char *str)
+{
+    char digits[5];
+    uint8_t count = 0;
+    do
+    {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value && count < sizeof(digits));
+
+    while (count)
+    {
+        *str++ = digits[--count];
+    }
+    *str = 0;
+}
@@ -0,0 +1,133 @@
+/* Copyright 2024, Darran A Lofthouse
+ *
+ * This file is part of pico-term.
+ *
+ * pico-term is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * pico-term is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with pico-term.
+ * If  not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Terminal Compositor
+ *
+ * Each pane is drawn to its own virtual surface, the compositor then merges the visible
+ * panes and writes only the cells which have changed since the previous frame.
+ */
+
+#ifndef TERMINAL_COMPOSITOR_H
+#define TERMINAL_COMPOSITOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "vt102.h"
+
+#define TC_MAX_PANES 8
+#define TC_NO_PANE 0xFF
+
+// Types
+
+struct tc_pane
+{
+    uint8_t top;            // Screen row of the top of the pane, 0 based.
+    uint8_t left;           // Screen column of the left of the pane, 0 based.
+    uint8_t rows;
+    uint8_t columns;
+    uint8_t z;              // Panes with a higher z are drawn over those with a lower z.
+    bool visible;
+    bool scrolling;         // Writing past the last row scrolls the pane instead of clipping.
+    char *surface;          // rows * columns characters provided by the caller.
+    uint8_t cursor_row;     // Write position within the pane.
+    uint8_t cursor_column;
+    uint8_t pending_scroll; // Lines scrolled since the last frame.
+    bool dirty;
+};
+
+struct tc_compositor
+{
+    uint8_t rows;
+    uint8_t columns;
+    uint8_t max_rows;       // Size of the screen and owner buffers.
+    uint8_t max_columns;
+    bool use_erase_characters;
+    char *screen;           // rows * columns, what the terminal is currently showing.
+    uint8_t *owner;         // rows * columns, index of the top most pane for each cell.
+    struct tc_pane *panes[TC_MAX_PANES];
+    uint16_t visible_cells[TC_MAX_PANES];
+    uint8_t pane_count;
+    struct tc_pane *focus;  // The pane the terminal cursor is left in after each frame.
+    bool screen_unknown;
+    bool layout_dirty;
+    bool cursor_known;
+    uint8_t cursor_row;
+    uint8_t cursor_column;
+};
+
+// Pane Functions
+
+/*
+ * Initialise a pane, the surface must hold rows * columns characters.
+ */
+void tc_pane_init(struct tc_pane *pane, uint8_t top, uint8_t left, uint8_t rows, uint8_t columns,
+                  char *surface, bool scrolling);
+
+void tc_pane_clear(struct tc_pane *pane);
+
+/*
+ * Move the write position within the pane, 0 based.
+ */
+void tc_pane_move(struct tc_pane *pane, uint8_t row, uint8_t column);
+
+/*
+ * Write to the pane, '\r' and '\n' move the write position and any other character
+ * which is not printable is dropped.
+ */
+void tc_pane_write_char(struct tc_pane *pane, char ch);
+
+void tc_pane_write_str(struct tc_pane *pane, char const *str);
+
+// Compositor Functions
+
+/*
+ * Initialise the compositor, screen and owner must each hold rows * columns entries.
+ */
+void tc_init(struct tc_compositor *compositor, uint8_t rows, uint8_t columns, char *screen, uint8_t *owner);
+
+bool tc_add_pane(struct tc_compositor *compositor, struct tc_pane *pane);
+
+void tc_set_z(struct tc_compositor *compositor, struct tc_pane *pane, uint8_t z);
+
+void tc_set_visible(struct tc_compositor *compositor, struct tc_pane *pane, bool visible);
+
+void tc_move_pane(struct tc_compositor *compositor, struct tc_pane *pane, uint8_t top, uint8_t left);
+
+/*
+ * Set the pane the terminal cursor should be left in, i.e. the input line.
+ */
+void tc_set_focus(struct tc_compositor *compositor, struct tc_pane *pane);
+
+/*
+ * Adapt the output to the capabilities of the connected terminal, the screen is clipped
+ * to the reported size if that is smaller than the size passed to tc_init.
+ */
+void tc_set_capabilities(struct tc_compositor *compositor, vt102_capabilities const *capabilities);
+
+/*
+ * The contents of the terminal are no longer known, e.g. after a reconnect, the next
+ * frame will clear the display and redraw everything.
+ */
+void tc_invalidate(struct tc_compositor *compositor);
+
+/*
+ * Write a single update to the terminal for everything that has changed since the last frame.
+ */
+void tc_render(struct tc_compositor *compositor);
+
+#endif // TERMINAL_COMPOSITOR_H
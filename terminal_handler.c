@@ -45,15 +45,37 @@ static void flush_cb()
     tud_cdc_n_write_flush(CDC_INTF);
 }
 
-#define READ_SIZE 5
+// Large enough to tell a CPR response from a function key before the ';' arrives.
+#define READ_SIZE 8
+#define MAX_RESPONSE_PARAMS 4
 
 struct read_status
 {
     uint8_t current_read_pos;
     char *current_read;
+    // Responses from the terminal can be longer than the read buffer so are decoded as they arrive.
+    bool in_response;
+    bool response_private;
+    uint8_t response_param_count;
+    uint16_t response_params[MAX_RESPONSE_PARAMS];
 };
 
 static uint32_t decode_event(struct read_status *read_status, struct vt102_event *vt102_event);
+static uint32_t decode_response(struct read_status *read_status, struct vt102_event *event);
+
+#define PROBE_DA 0x01
+#define PROBE_CPR 0x02
+#define PROBE_TIMEOUT_MS 500
+
+/*
+ * DA, DECSC, CUP 999;999, DSR 6 and DECRC - the cursor is moved as far as it can go so
+ * the CPR response is the size of the screen.
+ */
+static const char PROBE[] = { 0x1B, 0x5B, 0x63,
+                              0x1B, 0x37,
+                              0x1B, 0x5B, 0x39, 0x39, 0x39, 0x3B, 0x39, 0x39, 0x39, 0x48,
+                              0x1B, 0x5B, 0x36, 0x6E,
+                              0x1B, 0x38 };
 
 #define TERMINAL_CONTEXT_ID 0xAA
 struct terminal_context
@@ -67,8 +89,14 @@ struct terminal_context
     struct read_status read_status;
     vt102_event_handler event_handler;
     void *hand_back;
+    vt102_capabilities capabilities;
+    uint8_t probe_pending;
+    uint32_t probe_start;
 };
 
+static void probe_begin(struct terminal_context *term_context);
+static void probe_response(struct terminal_context *term_context, char final);
+
 void *terminal_handler_init()
 {
     struct terminal_context *context = malloc(sizeof(struct terminal_context));
@@ -79,6 +107,11 @@ void *terminal_handler_init()
     context->largest_available = 0;
     context->read_status.current_read_pos = 0;
     context->read_status.current_read = context->read_buffer;
+    context->read_status.in_response = false;
+    context->probe_pending = 0;
+
+    // The buffer lives as long as the context so secondary sinks survive reconnects.
+    tb_init(context->write_buffer, WRITE_BUFFER_LENGTH);
 
     return context;
 }
@@ -96,6 +129,17 @@ bool terminal_handler_begin(void *context, vt102_event_handler event_handler, vo
     term_context->hand_back = hand_back;
 }
 
+vt102_capabilities const *terminal_handler_capabilities(void *context)
+{
+    struct terminal_context *term_context = (struct terminal_context *)context;
+    if (term_context->id != TERMINAL_CONTEXT_ID)
+    {
+        printf("Invalid context passed to terminal_handler_capabilities 0x%02x\n", term_context->id);
+        return 0;
+    }
+
+    return &term_context->capabilities;
+}
 
 
 void terminal_handler_run(void *context)
@@ -114,11 +158,10 @@ void terminal_handler_run(void *context)
     {
         if (!term_context->connected)
         {
-            // We have connected.
+            // We have connected, the connect event is sent once probing is complete.
             term_context->connected = true;
-            struct vt102_event event = {connect, 0x00};
-            tb_init(term_context->write_buffer, WRITE_BUFFER_LENGTH);
-            term_context->event_handler(&event, term_context->hand_back);
+            _tb_attach_primary();
+            probe_begin(term_context);
         }
 
         if (_tb_write_size() > term_context->largest_send)
@@ -158,10 +201,26 @@ void terminal_handler_run(void *context)
 
             if (decode_event(&term_context->read_status, &event))
             {
-                // We have a complete event to handle.
-                term_context->event_handler(&event, term_context->hand_back);
+                if (event.event_type == response)
+                {
+                    probe_response(term_context, event.character);
+                }
+                else if (!term_context->probe_pending)
+                {
+                    // We have a complete event to handle, input before the connect event is dropped.
+                    term_context->event_handler(&event, term_context->hand_back);
+                }
             }
         }
+
+        if (term_context->probe_pending &&
+            to_ms_since_boot(get_absolute_time()) - term_context->probe_start > PROBE_TIMEOUT_MS)
+        {
+            // The terminal has not answered everything, continue with what we have.
+            term_context->probe_pending = 0;
+            struct vt102_event connect_event = {connect, 0x00};
+            term_context->event_handler(&connect_event, term_context->hand_back);
+        }
     }
     else
     {
@@ -169,15 +228,107 @@ void terminal_handler_run(void *context)
         {
             // We have disconnected.
             term_context->connected = false;
-            struct vt102_event event = {disconnect, 0x00};
-            term_context->event_handler(&event, term_context->hand_back);
-            tb_destroy(); // handle_disconnected may have wanted to drain the remaining input data.
+            if (term_context->probe_pending)
+            {
+                // The connect event was never sent so there is nothing to disconnect.
+                term_context->probe_pending = 0;
+            }
+            else
+            {
+                struct vt102_event event = {disconnect, 0x00};
+                term_context->event_handler(&event, term_context->hand_back);
+            }
+            _tb_detach_primary(); // Stop holding space for the client, secondary sinks keep buffering.
         }
     }
 }
 
+static void probe_begin(struct terminal_context *term_context)
+{
+    term_context->read_status.current_read_pos = 0;
+    term_context->read_status.in_response = false;
+
+    // Until the terminal answers assume a generic VT102 of unknown size.
+    term_context->capabilities.rows = 0;
+    term_context->capabilities.columns = 0;
+    term_context->capabilities.device_class = 0;
+    term_context->capabilities.erase_characters = false;
+
+    // Written straight to the client rather than the shared buffer so secondary sinks such as
+    // a UART mirror never see the queries, the CDC FIFO is empty immediately after connecting.
+    tud_cdc_n_write(CDC_INTF, PROBE, sizeof(PROBE));
+    tud_cdc_n_write_flush(CDC_INTF);
+
+    term_context->probe_pending = PROBE_DA | PROBE_CPR;
+    term_context->probe_start = to_ms_since_boot(get_absolute_time());
+}
+
+static void probe_response(struct terminal_context *term_context, char final)
+{
+    struct read_status *read_status = &term_context->read_status;
+    vt102_capabilities *capabilities = &term_context->capabilities;
+    uint8_t was_pending = term_context->probe_pending;
+
+    // Only replies to our own requests are accepted, e.g. xterm sends ESC [ 1 ; 5 R for Ctrl+F3.
+    if (final == 0x63 && read_status->response_private && (term_context->probe_pending & PROBE_DA))
+    {
+        // DA - ESC [ ? class ; options c
+        uint16_t device_class = read_status->response_params[0];
+        capabilities->device_class = device_class;
+        if (device_class >= 62)
+        {
+            // VT220 and later.
+            capabilities->erase_characters = true;
+        }
+        term_context->probe_pending &= ~PROBE_DA;
+    }
+    else if (final == 0x52 && read_status->response_param_count == 2 && (term_context->probe_pending & PROBE_CPR))
+    {
+        // CPR - ESC [ row ; column R
+        capabilities->rows = read_status->response_params[0];
+        capabilities->columns = read_status->response_params[1];
+        term_context->probe_pending &= ~PROBE_CPR;
+    }
+
+    if (was_pending && !term_context->probe_pending)
+    {
+        struct vt102_event event = {connect, 0x00};
+        term_context->event_handler(&event, term_context->hand_back);
+    }
+}
+
+/*
+ * Check if the CSI sequence in current_read is a response from the terminal rather than a key.
+ *
+ * Returns 1 for a response, 0 for a key, or -1 if more data is needed to decide.
+ */
+static int8_t is_response(struct read_status *read_status)
+{
+    for (uint8_t i = 2; i < read_status->current_read_pos; i++)
+    {
+        char ch = read_status->current_read[i];
+        if (ch == 0x3F || ch == 0x3B)
+        {
+            // None of the keys decoded below contain a '?' or ';'. Keys with modifiers such as
+            // xterm's ESC [ 1 ; 2 A do, these are decoded as responses and then ignored.
+            return 1;
+        }
+        else if (ch < 0x30 || ch > 0x39)
+        {
+            return 0;
+        }
+    }
+
+    return read_status->current_read_pos < READ_SIZE ? -1 : 0;
+}
+
 static uint32_t decode_event(struct read_status *read_status, struct vt102_event *event)
 {
+    if (read_status->in_response)
+    {
+        return decode_response(read_status, event);
+    }
+
     // Stage 2 - Use some, all, or none of the data in current_read
     // to process an event.
     uint8_t current_read_pos = read_status->current_read_pos;
@@ -202,12 +353,22 @@ static uint32_t decode_event(struct read_status *read_status, struct vt102_event
                 }
                 else if (current_read[1] == 0x5B)
                 {
-                    // We have a function key sequence.
-                    if (current_read_pos < 3)
+                    // We have a function key sequence or a response from the terminal.
+                    int8_t response = is_response(read_status);
+                    if (response < 0)
                     {
                         // We need to read more data to determine the function key.
                         return -1;
                     }
+                    else if (response)
+                    {
+                        // Skip the CSI, the parameters are decoded as they arrive.
+                        read_status->in_response = true;
+                        read_status->response_private = false;
+                        read_status->response_param_count = 1;
+                        read_status->response_params[0] = 0;
+                        chars_used = 2;
+                    }
                     else if (current_read[2] >= 0x41 && current_read[2] <= 0x44)
                     {
                         // Arrow Key
@@ -328,3 +489,59 @@ static uint32_t decode_event(struct read_status *read_status, struct vt102_event
     return 1;
 }
 
+static uint32_t decode_response(struct read_status *read_status, struct vt102_event *event)
+{
+    uint8_t chars_used = 0;
+    while (read_status->in_response && chars_used < read_status->current_read_pos)
+    {
+        char ch = read_status->current_read[chars_used++];
+        uint8_t param = read_status->response_param_count - 1;
+        if (ch == 0x3F)
+        {
+            read_status->response_private = true;
+        }
+        else if (ch >= 0x30 && ch <= 0x39)
+        {
+            if (param < MAX_RESPONSE_PARAMS)
+            {
+                // Saturate rather than wrap on oversized values.
+                uint16_t value = read_status->response_params[param];
+                read_status->response_params[param] = value <= (UINT16_MAX - 9) / 10 ? value * 10 + (ch - 0x30) : UINT16_MAX;
+            }
+        }
+        else if (ch == 0x3B)
+        {
+            // Any parameters past MAX_RESPONSE_PARAMS are ignored.
+            if (read_status->response_param_count <= MAX_RESPONSE_PARAMS)
+            {
+                if (read_status->response_param_count < MAX_RESPONSE_PARAMS)
+                {
+                    read_status->response_params[read_status->response_param_count] = 0;
+                }
+                read_status->response_param_count++;
+            }
+        }
+        else if (ch >= 0x40 && ch <= 0x7E)
+        {
+            // Final character, the response is complete.
+            read_status->in_response = false;
+            event->event_type = response;
+            event->character = ch;
+        }
+        else
+        {
+            // Not a valid response, leave the character to be decoded normally.
+            read_status->in_response = false;
+            chars_used--;
+        }
+    }
+
+    // Move the remaining data in current_read to the start of the buffer.
+    for (uint8_t i = chars_used; i < read_status->current_read_pos; i++)
+    {
+        read_status->current_read[i - chars_used] = read_status->current_read[i];
+    }
+    read_status->current_read_pos -= chars_used;
+
+    return 1;
+}
@@ -28,4 +28,9 @@ void *terminal_handler_init();
 bool terminal_handler_begin(void *context, vt102_event_handler event_handler, void *hand_back);
 void terminal_handler_run(void *context);
 
+/*
+ * The capabilities of the connected terminal, populated by the time the connect event is sent.
+ */
+vt102_capabilities const *terminal_handler_capabilities(void *context);
+
 #endif // TERMINAL_HANDLER_H
@@ -14,6 +14,12 @@
 
 const char ERASE_DISPLAY[] = { 033, 0133, 060, 0112};
 const char RIS[] = { 033, 0143 };
+const char DECSTBM_RESET[] = { 033, 0133, 0162 };
+const char IND[] = { 033, 0104 };
+const char DECSC[] = { 033, 067 };
+const char DECRC[] = { 033, 070 };
+const char DA[] = { 033, 0133, 0143 };
+const char DSR_CPR[] = { 033, 0133, 066, 0156 };
 
 // External Functions
 
@@ -38,6 +44,54 @@ void vt102_cup(char* line, char* column)
     // Don't flush, something likely to be written immediately after.
 }
 
+void vt102_decstbm(char* top, char* bottom)
+{
+    _vt102_write_char(033);
+    _vt102_write_char(0133);
+    _vt102_write_str(top);
+    _vt102_write_char(073);
+    _vt102_write_str(bottom);
+    _vt102_write_char(0162);
+}
+
+void vt102_decstbm_reset()
+{
+    _vt102_write(DECSTBM_RESET, 3);
+}
+
+void vt102_ind()
+{
+    _vt102_write(IND, 2);
+}
+
+void vt102_ech(char* count)
+{
+    _vt102_write_char(033);
+    _vt102_write_char(0133);
+    _vt102_write_str(count);
+    _vt102_write_char(0130);
+}
+
+void vt102_decsc()
+{
+    _vt102_write(DECSC, 2);
+}
+
+void vt102_decrc()
+{
+    _vt102_write(DECRC, 2);
+}
+
+void vt102_da()
+{
+    _vt102_write(DA, 3);
+}
+
+void vt102_dsr_cpr()
+{
+    _vt102_write(DSR_CPR, 4);
+}
+
 // Internal Functions
 // TODO An API will be added to these can output to different destinations:
 //    - STDOUT
@@ -50,6 +104,11 @@ uint32_t _vt102_write (void const* buffer, uint32_t bufsize)
     return tb_write(buffer, bufsize);
 }
 
+uint32_t _vt102_write_available (void)
+{
+    return tb_write_available();
+}
+
 uint32_t _vt102_write_char (char ch)
 {
     return _vt102_write(&ch, 1);
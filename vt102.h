@@ -22,12 +22,13 @@
 #define VT102_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 // Types
 
 enum vt102_event_type
 {
-    connect, disconnect, none, character, control, alt, special
+    connect, disconnect, none, character, control, alt, special, response
 };
 
 static inline const char* vt102_event_type_to_string(enum vt102_event_type type)
@@ -41,6 +42,7 @@ static inline const char* vt102_event_type_to_string(enum vt102_event_type type)
         case control: return "control";
         case alt: return "alt";
         case special: return "special";
+        case response: return "response";
         default: return "unknown";
     }
 }
@@ -89,6 +91,19 @@ struct vt102_event
 
 typedef struct vt102_event vt102_event;
 
+/*
+ * Capabilities of the connected terminal as reported by the DA and CPR responses.
+ */
+struct vt102_capabilities
+{
+    uint16_t rows;          // Screen height, 0 if not known.
+    uint16_t columns;       // Screen width, 0 if not known.
+    uint16_t device_class;  // First parameter of the DA response, 0 if there was no response.
+    bool erase_characters;  // ECH
+};
+
+typedef struct vt102_capabilities vt102_capabilities;
+
 // External Functions - All start vt102
 
 /*
@@ -106,6 +121,46 @@ void vt102_erase_display();
  */
 void vt102_cup(char* line, char* column);
 
+/*
+ * Set Top and Bottom Margins (Scroll Region)
+ */
+void vt102_decstbm(char* top, char* bottom);
+
+/*
+ * Reset the Scroll Region to the Full Screen
+ */
+void vt102_decstbm_reset();
+
+/*
+ * Index - Move down one line, scrolling at the bottom margin
+ */
+void vt102_ind();
+
+/*
+ * Erase Characters - Not available before the VT220
+ */
+void vt102_ech(char* count);
+
+/*
+ * Save Cursor
+ */
+void vt102_decsc();
+
+/*
+ * Restore Cursor
+ */
+void vt102_decrc();
+
+/*
+ * Device Attributes - Request the terminal identifies itself
+ */
+void vt102_da();
+
+/*
+ * Device Status Report - Request the terminal reports the cursor position
+ */
+void vt102_dsr_cpr();
+
 // Internal Functions - All start _vt102
 
 /*
@@ -113,6 +168,11 @@ void vt102_cup(char* line, char* column);
  */
 uint32_t _vt102_write (void const* buffer, uint32_t bufsize);
 
+/*
+ * Space available to write to the terminal without data being dropped
+ */
+uint32_t _vt102_write_available (void);
+
 /*
  * Write a single character to the terminal
  */